@@ -3,10 +3,6 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#ifdef SIO_USE_URING
-#include <liburing.h>
-#endif // SIO_USE_URING
-
 struct sio_string {
 	size_t length;
 	char *chars;
@@ -17,28 +13,112 @@ struct sio_path {
 };
 
 struct sio_file {
-	int ret_p;
-	FILE *file;
+	int fd;
+};
+
+struct sio_dir {
+	int fd;
 };
 
-struct sio_context {
-	bool ok;
-#ifdef SIO_USE_URING
-	struct io_uring ring;
-	int flags;
-#endif // SIO_USE_URING
+/* Flags for sio_open_at, mapped onto openat2 RESOLVE_* flags. */
+enum sio_resolve {
+	SIO_RESOLVE_NONE = 0,
+	SIO_RESOLVE_BENEATH = 1 << 0, /* fail if path escapes dir */
+	SIO_RESOLVE_CACHED = 1 << 1,  /* dcache lookup only, EAGAIN on miss */
 };
 
+/* borrowed view into memory owned by someone else, not null terminated */
+struct sio_span {
+	const char *chars;
+	size_t length;
+};
+
+/*
+ * Offsets of delim separated records in a read-only file, persisted in a
+ * "<path>.sioidx" sidecar and reused while the file size and mtime match.
+ * sio_record_get may be called from several threads at once, opening and
+ * closing may not overlap with lookups.
+ */
+struct sio_index;
+
+/*
+ * Called from worker threads with one delim aligned chunk. Every chunk ends
+ * with its delim except possibly the last, when the file does not end with
+ * one. Return false to stop the remaining chunks.
+ */
+typedef bool (*sio_chunk_fn)(void *user, struct sio_span chunk, size_t index);
+
+/*
+ * Append-only log with group commit. Appenders may run on any thread,
+ * sio_log_flush and sio_log_close must only be called by one flusher.
+ * Appenders must have stopped before sio_log_close, which flushes what is
+ * staged and then frees the staging buffer.
+ */
+struct sio_log;
+
+/*
+ * Required for every record. res is 0 once the record is durable, -errno if
+ * the write failed. Either way the record's data may be released from here.
+ */
+typedef void (*sio_log_done_fn)(void *user, int res);
+
+#ifdef SIO_FAULT_INJECTION
+/* stand-in backend faults for the stress test, 0 disables a fault */
+struct sio_fault {
+	size_t max_io;		   /* clamp each read to this size */
+	unsigned busy_every;	   /* nth sqe grab sees a full sq, or nth
+				      pread fails with EINTR */
+	unsigned short_read_every; /* nth read reports half of its bytes */
+	unsigned nbusy;		   /* counters, reset by the setter */
+	unsigned nshort;
+};
+#endif // SIO_FAULT_INJECTION
+
+/* backend state, its layout depends on how the library was built */
+struct sio_context;
+
 /* SIO_FILE */
 struct sio_file *sio_file_new(void);
 void sio_file_free(struct sio_file *p);
 struct sio_string *sio_read_file(struct sio_context *ctx,
 				 struct sio_file *file);
+bool sio_read_file_into(struct sio_context *ctx, struct sio_file *file,
+			struct sio_string *out);
+bool sio_read_files_into(struct sio_context *ctx, struct sio_file *files,
+			 size_t count, struct sio_string *out);
+
+/* SIO_DIR */
+struct sio_dir *sio_dir_open(struct sio_context *ctx, struct sio_path *path);
+void sio_dir_close(struct sio_context *ctx, struct sio_dir *dir);
+struct sio_file *sio_open_at(struct sio_context *ctx, struct sio_dir *dir,
+			     struct sio_path *path, const char *mode,
+			     int resolve);
+
+/* SIO_PARALLEL */
+int sio_parallel_for_chunks(struct sio_context *ctx, struct sio_file *file,
+			    size_t chunk_size, char delim, sio_chunk_fn fn,
+			    void *user, unsigned nthreads);
+
+/* SIO_INDEX */
+struct sio_index *sio_index_open(struct sio_context *ctx, struct sio_path *path,
+				 char delim);
+void sio_index_close(struct sio_index *index);
+size_t sio_index_count(const struct sio_index *index);
+struct sio_span sio_record_get(struct sio_index *index, size_t n);
+
+/* SIO_LOG */
+struct sio_log *sio_log_open(struct sio_context *ctx, struct sio_path *path,
+			     size_t capacity);
+void sio_log_close(struct sio_log *log);
+bool sio_log_append(struct sio_log *log, const void *data, size_t length,
+		    sio_log_done_fn done, void *user);
+int sio_log_flush(struct sio_log *log);
 
 /* SIO_PATH */
 struct sio_path *sio_path_new(void);
 void sio_path_free(struct sio_path *p);
 struct sio_path *sio_path_from_c_str(const char *s);
+struct sio_path sio_path_view(const char *s);
 
 /* SIO_STRING */
 struct sio_string *sio_string_new(void);
@@ -51,6 +131,13 @@ void sio_string_take_from_chars(struct sio_string *s, char *data);
 /* SIO_CONTEXT */
 struct sio_context *sio_context_init(void);
 void sio_context_destroy(struct sio_context *ctx);
+#ifdef SIO_FAULT_INJECTION
+void sio_context_set_fault(struct sio_context *ctx,
+			   const struct sio_fault *fault);
+#endif // SIO_FAULT_INJECTION
 struct sio_file *sio_open(struct sio_context *ctx, struct sio_path *path,
 			  const char *mode);
 void sio_close(struct sio_context *ctx, struct sio_file *file);
+bool sio_open_cstr(struct sio_context *ctx, const char *path, const char *mode,
+		   struct sio_file *file);
+void sio_file_close(struct sio_context *ctx, struct sio_file *file);
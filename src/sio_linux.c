@@ -1,3 +1,4 @@
+#define _GNU_SOURCE /* O_PATH */
 #include <sio/sio.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -5,8 +6,17 @@
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/openat2.h>
 
 #ifdef SIO_USE_URING
 #include <liburing.h>
@@ -68,6 +78,20 @@
 	} while (0)
 
 /* SIO_PATH */
+/*
+ * Borrows s without copying it. The view must not outlive s and must not
+ * be passed to sio_path_free.
+ */
+struct sio_path sio_path_view(const char *s)
+{
+	assert(s);
+
+	struct sio_path path = {
+	    .path_str = {.length = strlen(s), .chars = (char *)s},
+	};
+	return path;
+}
+
 struct sio_path *sio_path_new(void)
 {
 	struct sio_path *p = nullptr;
@@ -165,8 +189,7 @@ struct sio_file *sio_file_new(void)
 {
 	struct sio_file *f = nullptr;
 	SIO_MALLOC(f, 1);
-	f->ret_p = 0;
-	f->file = nullptr;
+	f->fd = -1;
 	return f;
 }
 
@@ -175,15 +198,28 @@ void sio_file_free(struct sio_file *p)
 	if (!p)
 		return;
 
-	if (p->file != nullptr) {
-		fclose(p->file);
-		p->file = nullptr;
+	if (p->fd >= 0) {
+		close(p->fd);
+		p->fd = -1;
 	}
 
 	SIO_FREE(p);
 }
 
 /* SIO_CONTEXT */
+struct sio_context {
+	bool ok;
+#ifdef SIO_USE_URING
+	struct io_uring ring;
+	int flags;
+	unsigned entries;
+	bool ring_failed; /* completions were left unreaped, ring unusable */
+#endif // SIO_USE_URING
+#ifdef SIO_FAULT_INJECTION
+	struct sio_fault fault;
+#endif // SIO_FAULT_INJECTION
+};
+
 struct sio_context *sio_context_init(void)
 {
 	struct sio_context *ctx = nullptr;
@@ -194,6 +230,7 @@ struct sio_context *sio_context_init(void)
 	ctx->flags = 0;
 
 	const unsigned int entries = 100; /* TODO: make this a param */
+	ctx->entries = entries;
 	int ret = io_uring_queue_init(entries, &ctx->ring, ctx->flags);
 	if (ret != 0) {
 		fprintf(stderr, "io_uring_queue_init failed: errno=%d\n", -ret);
@@ -214,150 +251,1456 @@ void sio_context_destroy(struct sio_context *ctx)
 	SIO_FREE(ctx);
 }
 
-#ifdef SIO_USE_URING
-struct sio_string *sio_read_file(struct sio_context *ctx, struct sio_file *file)
+#ifdef SIO_FAULT_INJECTION
+/* replaces the faults injected by ctx and restarts their counters */
+void sio_context_set_fault(struct sio_context *ctx,
+			   const struct sio_fault *fault)
 {
 	assert(ctx);
+	assert(fault);
 
-	if (!file || !file->file)
-		return nullptr;
+	ctx->fault = *fault;
+	ctx->fault.nbusy = 0;
+	ctx->fault.nshort = 0;
+}
+#endif // SIO_FAULT_INJECTION
 
-	const int fd = fileno(file->file);
-	if (fd == -1) {
-		perror("fileno");
-		return nullptr;
+/* translate an fopen style mode string into open(2) flags, -1 if invalid */
+static int sio_mode_to_flags(const char *mode)
+{
+	assert(mode);
+
+	int flags = 0;
+	switch (mode[0]) {
+	case 'r':
+		flags = O_RDONLY;
+		break;
+	case 'w':
+		flags = O_WRONLY | O_CREAT | O_TRUNC;
+		break;
+	case 'a':
+		flags = O_WRONLY | O_CREAT | O_APPEND;
+		break;
+	default:
+		return -1;
 	}
 
-	struct stat st;
-	if (fstat(fd, &st) == -1) {
-		perror("fstat");
-		fprintf(stderr, "Failed fstat for fd: %d\n", fd);
-		return nullptr;
+	for (const char *c = mode + 1; *c != '\0'; c++) {
+		switch (*c) {
+		case '+':
+			flags = (flags & ~O_ACCMODE) | O_RDWR;
+			break;
+		case 'x':
+			flags |= O_EXCL;
+			break;
+		case 'e':
+			flags |= O_CLOEXEC;
+			break;
+		default:
+			break; /* 'b' and glibc extensions are ignored */
+		}
 	}
-	const size_t len = st.st_size;
 
-	/* file empty */
-	if (len == 0) {
-		struct sio_string *s = sio_string_new();
-		return s;
+	return flags;
+}
+
+static uint64_t sio_resolve_to_kernel(int resolve)
+{
+	uint64_t r = 0;
+	if (resolve & SIO_RESOLVE_BENEATH)
+		r |= RESOLVE_BENEATH;
+	if (resolve & SIO_RESOLVE_CACHED)
+		r |= RESOLVE_CACHED;
+	return r;
+}
+
+/* stand-in faults, all no-ops unless built with SIO_FAULT_INJECTION */
+#ifdef SIO_FAULT_INJECTION
+static bool sio_fault_hit(unsigned every, unsigned *counter)
+{
+	return every != 0 && ++*counter % every == 0;
+}
+#endif // SIO_FAULT_INJECTION
+
+/* pretend the sq is full, or for plain reads that one got interrupted */
+static bool sio_fault_busy(struct sio_context *ctx)
+{
+#ifdef SIO_FAULT_INJECTION
+	return sio_fault_hit(ctx->fault.busy_every, &ctx->fault.nbusy);
+#else
+	(void)ctx;
+	return false;
+#endif // SIO_FAULT_INJECTION
+}
+
+/* report only half of a completed read, the rest is read again */
+static ssize_t sio_fault_short(struct sio_context *ctx, ssize_t res)
+{
+#ifdef SIO_FAULT_INJECTION
+	if (res > 1 &&
+	    sio_fault_hit(ctx->fault.short_read_every, &ctx->fault.nshort))
+		return res / 2;
+#else
+	(void)ctx;
+#endif // SIO_FAULT_INJECTION
+	return res;
+}
+
+#ifdef SIO_USE_URING
+static struct io_uring_sqe *sio_get_sqe(struct sio_context *ctx)
+{
+	/* stale completions would be taken for the new request's */
+	if (ctx->ring_failed)
+		return nullptr;
+
+	struct io_uring_sqe *sqe =
+	    sio_fault_busy(ctx) ? nullptr : io_uring_get_sqe(&ctx->ring);
+	if (!sqe) {
+		/* sq is full, hand pending entries to the kernel and retry */
+		io_uring_submit(&ctx->ring);
+		sqe = io_uring_get_sqe(&ctx->ring);
 	}
+	return sqe;
+}
 
-	char *buf = nullptr;
-	SIO_MALLOC(buf, len);
+/* returns the new fd, or -errno on failure */
+static int sio_openat_fd(struct sio_context *ctx, int dirfd, const char *path,
+			 int flags, int resolve)
+{
+	struct open_how how = {
+	    .flags = (uint64_t)flags,
+	    .mode = (flags & O_CREAT) ? 0666 : 0,
+	    .resolve = sio_resolve_to_kernel(resolve),
+	};
 
-	struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
+	struct io_uring_sqe *sqe = sio_get_sqe(ctx);
 	if (!sqe) {
-		io_uring_submit(
-		    &ctx->ring); /* sqe might be full, submit first */
-		fprintf(stderr, "Failed to get sqe entry");
-		SIO_FREE(buf);
-		return nullptr;
+		fprintf(stderr, "Failed to get sqe entry\n");
+		return -EBUSY;
 	}
 
-	io_uring_prep_read(sqe, fd, buf, len, 0);
+	if (how.resolve != 0)
+		io_uring_prep_openat2(sqe, dirfd, path, &how);
+	else
+		io_uring_prep_openat(sqe, dirfd, path, flags, how.mode);
 
 	int ret = io_uring_submit(&ctx->ring);
 	if (ret < 0) {
 		fprintf(stderr, "Failed sqe submit, errno: %d\n", ret);
-		SIO_FREE(buf);
-		return nullptr;
+		return ret;
 	}
 
 	struct io_uring_cqe *cqe = nullptr;
 	ret = io_uring_wait_cqe(&ctx->ring, &cqe);
-	if (cqe->res < 0) {
-		fprintf(stderr, "Failed io_uring_cqe_get: errno=%d\n",
-			cqe->res);
-		io_uring_cqe_seen(&ctx->ring, cqe);
-		SIO_FREE(buf);
-		return nullptr;
+	if (ret < 0) {
+		fprintf(stderr, "Failed io_uring_wait_cqe: errno=%d\n", -ret);
+		return ret;
 	}
+
+	ret = cqe->res;
 	io_uring_cqe_seen(&ctx->ring, cqe);
+	return ret;
+}
+#else // SIO_USE_URING
+/* returns the new fd, or -errno on failure */
+static int sio_openat_fd(struct sio_context *ctx, int dirfd, const char *path,
+			 int flags, int resolve)
+{
+	assert(ctx);
 
-	if ((size_t)cqe->res != len) {
-		fprintf(stderr, "short read: got: %d, expected: %ld\n",
-			cqe->res, len);
-		SIO_FREE(buf);
-		return nullptr;
+	int fd = -1;
+	if (resolve == SIO_RESOLVE_NONE) {
+		fd = openat(dirfd, path, flags, 0666);
+	} else {
+		struct open_how how = {
+		    .flags = (uint64_t)flags,
+		    .mode = (flags & O_CREAT) ? 0666 : 0,
+		    .resolve = sio_resolve_to_kernel(resolve),
+		};
+		fd = (int)syscall(SYS_openat2, dirfd, path, &how, sizeof(how));
 	}
 
-	struct sio_string *content = sio_string_new();
-	sio_string_copy_from_chars_with_length(content, buf, len);
-	SIO_FREE(buf);
+	return fd == -1 ? -errno : fd;
+}
+#endif // SIO_USE_URING
 
-	return content;
+/* largest single read(2), also keeps byte counts within a cqe's int res */
+#define SIO_MAX_IO ((size_t)0x7ffff000)
+
+struct sio_read_op {
+	int fd;
+	char *buf;
+	size_t len;
+	size_t done;
+	int res; /* -errno once the op failed */
+	bool in_flight;
+};
+
+static bool sio_read_op_init(struct sio_file *file, struct sio_read_op *op)
+{
+	*op = (struct sio_read_op){.fd = -1};
+
+	if (!file || file->fd < 0) {
+		op->res = -EBADF;
+		return false;
+	}
+	op->fd = file->fd;
+
+	struct stat st;
+	if (fstat(op->fd, &st) == -1) {
+		op->res = -errno;
+		perror("fstat");
+		fprintf(stderr, "Failed fstat for fd: %d\n", op->fd);
+		return false;
+	}
+	op->len = st.st_size;
+
+	/* read straight into the string, + 1 for null terminator */
+	if (op->len != 0)
+		SIO_MALLOC(op->buf, op->len + 1);
+	return true;
+}
+
+static size_t sio_read_op_next_len(struct sio_context *ctx,
+				   const struct sio_read_op *op)
+{
+	size_t n = op->len - op->done;
+	if (n > SIO_MAX_IO)
+		n = SIO_MAX_IO;
+#ifdef SIO_FAULT_INJECTION
+	if (ctx->fault.max_io != 0 && n > ctx->fault.max_io)
+		n = ctx->fault.max_io;
+#else
+	(void)ctx;
+#endif // SIO_FAULT_INJECTION
+	return n;
+}
+
+static void sio_read_op_advance(struct sio_read_op *op, size_t bytes)
+{
+	if (bytes == 0) {
+		/* file shrank underneath us */
+		fprintf(stderr, "short read: got: %zu, expected: %zu\n",
+			op->done, op->len);
+		op->res = -EIO;
+		return;
+	}
+	op->done += bytes;
+}
+
+/* hands the buffer to out on success, frees it otherwise */
+static bool sio_read_op_finish(struct sio_read_op *op, struct sio_string *out)
+{
+	if (op->res != 0 || op->done != op->len) {
+		SIO_FREE(op->buf);
+		return false;
+	}
+
+	if (op->buf)
+		op->buf[op->len] = '\0';
+	out->chars = op->buf;
+	out->length = op->len;
+	return true;
+}
+
+#ifdef SIO_USE_URING
+static bool sio_queue_read(struct sio_context *ctx, struct sio_read_op *op,
+			   uint64_t index)
+{
+	struct io_uring_sqe *sqe = sio_get_sqe(ctx);
+	if (!sqe) {
+		fprintf(stderr, "Failed to get sqe entry\n");
+		op->res = -EBUSY;
+		return false;
+	}
+
+	io_uring_prep_read(sqe, op->fd, op->buf + op->done,
+			   (unsigned)sio_read_op_next_len(ctx, op), op->done);
+	io_uring_sqe_set_data64(sqe, index);
+	op->in_flight = true;
+	return true;
+}
+
+/*
+ * Keeps up to ctx->entries reads in flight and refills the ring as
+ * completions arrive. Files larger than SIO_MAX_IO and short reads are
+ * continued with another read for the remainder. Only returns once every
+ * queued read completed, unless the ring itself is beyond use.
+ */
+static void sio_read_ops(struct sio_context *ctx, struct sio_read_op *ops,
+			 size_t count)
+{
+	struct io_uring *ring = &ctx->ring;
+	size_t next = 0;
+	size_t in_flight = 0;
+	bool failed = false;
+
+	for (;;) {
+		for (; next < count && in_flight < ctx->entries; next++) {
+			struct sio_read_op *op = &ops[next];
+			if (op->res == 0 && op->done < op->len &&
+			    sio_queue_read(ctx, op, next))
+				in_flight++;
+		}
+
+		if (in_flight == 0)
+			break;
+
+		int ret = io_uring_submit_and_wait(ring, 1);
+		if (ret < 0 && ret != -EINTR && ret != -EAGAIN &&
+		    ret != -EBUSY) {
+			fprintf(stderr, "Failed sqe submit, errno: %d\n", ret);
+			if (failed) {
+				/*
+				 * can't reap, keep others off the ring and
+				 * leak buffers the kernel may still write
+				 */
+				ctx->ring_failed = true;
+				for (size_t i = 0; i < count; i++) {
+					if (ops[i].in_flight)
+						ops[i].buf = nullptr;
+				}
+				return;
+			}
+
+			/* queue nothing more, but reap what is in flight */
+			failed = true;
+			for (size_t i = 0; i < count; i++) {
+				if (ops[i].res == 0)
+					ops[i].res = ret;
+			}
+			continue;
+		}
+
+		struct io_uring_cqe *cqe = nullptr;
+		while (io_uring_peek_cqe(ring, &cqe) == 0) {
+			const uint64_t index = io_uring_cqe_get_data64(cqe);
+			struct sio_read_op *op = &ops[index];
+			const ssize_t res = sio_fault_short(ctx, cqe->res);
+			io_uring_cqe_seen(ring, cqe);
+			op->in_flight = false;
+			in_flight--;
+
+			if (res < 0 && res != -EINTR && res != -EAGAIN) {
+				fprintf(stderr,
+					"Failed io_uring read: errno=%d\n",
+					(int)-res);
+				op->res = (int)res;
+				continue;
+			}
+
+			if (res >= 0)
+				sio_read_op_advance(op, (size_t)res);
+			if (op->res == 0 && op->done < op->len &&
+			    sio_queue_read(ctx, op, index))
+				in_flight++;
+		}
+	}
 }
 #else // SIO_USE_URING
+static ssize_t sio_pread(struct sio_context *ctx, int fd, void *buf,
+			 size_t len, off_t offset)
+{
+	if (sio_fault_busy(ctx)) {
+		errno = EINTR;
+		return -1;
+	}
+	return pread(fd, buf, len, offset);
+}
+
+static void sio_read_ops(struct sio_context *ctx, struct sio_read_op *ops,
+			 size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		struct sio_read_op *op = &ops[i];
+		while (op->res == 0 && op->done < op->len) {
+			const ssize_t ret =
+			    sio_pread(ctx, op->fd, op->buf + op->done,
+				      sio_read_op_next_len(ctx, op), op->done);
+			if (ret == -1) {
+				if (errno == EINTR)
+					continue;
+				op->res = -errno;
+				perror("pread");
+				break;
+			}
+			sio_read_op_advance(op, sio_fault_short(ctx, ret));
+		}
+	}
+}
+#endif // SIO_USE_URING
+
+bool sio_read_file_into(struct sio_context *ctx, struct sio_file *file,
+			struct sio_string *out)
+{
+	assert(ctx);
+	assert(out);
+	assert(out->length == 0);
+	assert(out->chars == nullptr);
+
+	struct sio_read_op op;
+	if (!sio_read_op_init(file, &op))
+		return false;
+
+	sio_read_ops(ctx, &op, 1);
+	return sio_read_op_finish(&op, out);
+}
+
+/*
+ * Reads count files in one batch. out must hold count empty strings.
+ * Returns false if any file failed, its string is then left empty.
+ */
+bool sio_read_files_into(struct sio_context *ctx, struct sio_file *files,
+			 size_t count, struct sio_string *out)
+{
+	assert(ctx);
+	assert(files || count == 0);
+	assert(out || count == 0);
+
+	struct sio_read_op *ops = nullptr;
+	SIO_MALLOC(ops, count);
+	for (size_t i = 0; i < count; i++) {
+		assert(out[i].length == 0);
+		assert(out[i].chars == nullptr);
+		sio_read_op_init(&files[i], &ops[i]);
+	}
+
+	sio_read_ops(ctx, ops, count);
+
+	bool ok = true;
+	for (size_t i = 0; i < count; i++)
+		ok &= sio_read_op_finish(&ops[i], &out[i]);
+
+	SIO_FREE(ops);
+	return ok;
+}
+
 struct sio_string *sio_read_file(struct sio_context *ctx, struct sio_file *file)
+{
+	struct sio_string *content = sio_string_new();
+	if (!sio_read_file_into(ctx, file, content)) {
+		sio_string_free(content);
+		return nullptr;
+	}
+	return content;
+}
+
+/* opens into caller owned storage, no allocations besides the kernel fd */
+bool sio_open_cstr(struct sio_context *ctx, const char *path, const char *mode,
+		   struct sio_file *file)
 {
 	assert(ctx);
+	assert(path);
+	assert(file);
+
+	file->fd = -1;
+
+	const int flags = sio_mode_to_flags(mode);
+	if (flags == -1) {
+		fprintf(stderr, "invalid mode: %s\n", mode);
+		errno = EINVAL;
+		return false;
+	}
 
-	if (!file || !file->file)
+	const int fd =
+	    sio_openat_fd(ctx, AT_FDCWD, path, flags, SIO_RESOLVE_NONE);
+	if (fd < 0) {
+		fprintf(stderr, "open failed for path: %s, errno=%d\n", path,
+			-fd);
+		errno = -fd;
+		return false;
+	}
+
+	file->fd = fd;
+	return true;
+}
+
+struct sio_file *sio_open(struct sio_context *ctx, struct sio_path *path,
+			  const char *mode)
+{
+	assert(ctx);
+	assert(path);
+	assert(path->path_str.length != 0);
+	assert(path->path_str.chars != nullptr);
+	assert(path->path_str.chars[path->path_str.length] == '\0');
+
+	struct sio_file *file = sio_file_new();
+	if (!sio_open_cstr(ctx, path->path_str.chars, mode, file)) {
+		sio_file_free(file);
 		return nullptr;
+	}
 
-	const int fd = fileno(file->file);
-	if (fd == -1) {
-		perror("fileno");
+	return file;
+}
+
+/* closes a file opened with sio_open_cstr, leaves its storage alone */
+void sio_file_close(struct sio_context *ctx, struct sio_file *file)
+{
+	assert(ctx);
+
+	if (!file || file->fd < 0)
+		return;
+
+	close(file->fd);
+	file->fd = -1;
+}
+
+void sio_close(struct sio_context *ctx, struct sio_file *file)
+{
+	assert(ctx);
+	sio_file_free(file);
+}
+
+/* SIO_DIR */
+struct sio_dir *sio_dir_open(struct sio_context *ctx, struct sio_path *path)
+{
+	assert(ctx);
+	assert(path);
+	assert(path->path_str.length != 0);
+	assert(path->path_str.chars != nullptr);
+
+	const int fd =
+	    sio_openat_fd(ctx, AT_FDCWD, path->path_str.chars,
+			  O_PATH | O_DIRECTORY | O_CLOEXEC, SIO_RESOLVE_NONE);
+	if (fd < 0) {
+		fprintf(stderr, "open dir failed for path: %s, errno=%d\n",
+			path->path_str.chars, -fd);
+		errno = -fd;
+		return nullptr;
+	}
+
+	struct sio_dir *dir = nullptr;
+	SIO_MALLOC(dir, 1);
+	dir->fd = fd;
+	return dir;
+}
+
+void sio_dir_close(struct sio_context *ctx, struct sio_dir *dir)
+{
+	assert(ctx);
+
+	if (!dir)
+		return;
+
+	if (dir->fd >= 0) {
+		close(dir->fd);
+		dir->fd = -1;
+	}
+
+	SIO_FREE(dir);
+}
+
+/*
+ * Opens path relative to dir, so the kernel only walks the remaining
+ * components. With SIO_RESOLVE_CACHED the open fails with errno set to
+ * EAGAIN when the lookup would block; callers retry without the flag.
+ */
+struct sio_file *sio_open_at(struct sio_context *ctx, struct sio_dir *dir,
+			     struct sio_path *path, const char *mode,
+			     int resolve)
+{
+	assert(ctx);
+	assert(dir);
+	assert(path);
+	assert(path->path_str.length != 0);
+	assert(path->path_str.chars != nullptr);
+	assert(path->path_str.chars[path->path_str.length] == '\0');
+
+	const int flags = sio_mode_to_flags(mode);
+	if (flags == -1) {
+		fprintf(stderr, "invalid mode: %s\n", mode);
+		errno = EINVAL;
+		return nullptr;
+	}
+
+	const int fd =
+	    sio_openat_fd(ctx, dir->fd, path->path_str.chars, flags, resolve);
+	if (fd < 0) {
+		/* a cache miss is an expected outcome, not an error */
+		if (fd != -EAGAIN || !(resolve & SIO_RESOLVE_CACHED))
+			fprintf(stderr,
+				"openat failed for path: %s, errno=%d\n",
+				path->path_str.chars, -fd);
+		errno = -fd;
 		return nullptr;
 	}
 
+	struct sio_file *file = sio_file_new();
+	file->fd = fd;
+	return file;
+}
+
+/* SIO_PARALLEL */
+/* a worker's [next, end) chunk range packed into one word, so the owner
+ * popping from the front and thieves splitting off the back can both CAS */
+#define SIO_RANGE_PACK(next, end) (((uint64_t)(end) << 32) | (uint32_t)(next))
+#define SIO_RANGE_NEXT(r) ((size_t)((r) & 0xffffffffu))
+#define SIO_RANGE_END(r) ((size_t)((r) >> 32))
+
+struct sio_parallel_worker {
+	_Atomic uint64_t range;
+	struct sio_parallel *shared;
+	unsigned id;
+};
+
+struct sio_parallel {
+	const char *data;
+	const size_t *bounds; /* nchunks + 1 chunk start offsets */
+	size_t nchunks;
+	sio_chunk_fn fn;
+	void *user;
+	unsigned nworkers;
+	struct sio_parallel_worker *workers;
+	atomic_bool stop;
+};
+
+static bool sio_range_pop(struct sio_parallel_worker *w, size_t *index)
+{
+	uint64_t r = atomic_load_explicit(&w->range, memory_order_acquire);
+	for (;;) {
+		const size_t next = SIO_RANGE_NEXT(r);
+		const size_t end = SIO_RANGE_END(r);
+		if (next >= end)
+			return false;
+		if (atomic_compare_exchange_weak_explicit(
+			&w->range, &r, SIO_RANGE_PACK(next + 1, end),
+			memory_order_acq_rel, memory_order_acquire)) {
+			*index = next;
+			return true;
+		}
+	}
+}
+
+/* moves the back half of some other worker's range into w */
+static bool sio_range_steal(struct sio_parallel_worker *w)
+{
+	struct sio_parallel *p = w->shared;
+	for (unsigned i = 1; i < p->nworkers; i++) {
+		struct sio_parallel_worker *victim =
+		    &p->workers[(w->id + i) % p->nworkers];
+		uint64_t r =
+		    atomic_load_explicit(&victim->range, memory_order_acquire);
+		for (;;) {
+			const size_t next = SIO_RANGE_NEXT(r);
+			const size_t end = SIO_RANGE_END(r);
+			if (next >= end)
+				break;
+			const size_t mid = next + (end - next) / 2;
+			if (atomic_compare_exchange_weak_explicit(
+				&victim->range, &r, SIO_RANGE_PACK(next, mid),
+				memory_order_acq_rel, memory_order_acquire)) {
+				atomic_store_explicit(&w->range,
+						      SIO_RANGE_PACK(mid, end),
+						      memory_order_release);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static void sio_readahead_chunk(const struct sio_parallel *p, size_t index)
+{
+	if (index >= p->nchunks)
+		return;
+
+	/* madvise wants a page aligned start */
+	const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	const uintptr_t begin = (uintptr_t)(p->data + p->bounds[index]);
+	const uintptr_t end = (uintptr_t)(p->data + p->bounds[index + 1]);
+	const uintptr_t aligned = begin & ~(page - 1);
+	madvise((void *)aligned, end - aligned, MADV_WILLNEED);
+}
+
+static void *sio_parallel_worker_run(void *arg)
+{
+	struct sio_parallel_worker *w = arg;
+	struct sio_parallel *p = w->shared;
+
+	for (;;) {
+		size_t index = 0;
+		if (!sio_range_pop(w, &index)) {
+			if (!sio_range_steal(w))
+				break;
+			continue;
+		}
+
+		if (atomic_load_explicit(&p->stop, memory_order_relaxed))
+			break;
+
+		/* fault in the following chunk while this one is parsed */
+		sio_readahead_chunk(p, index + 1);
+
+		const struct sio_span chunk = {
+		    .chars = p->data + p->bounds[index],
+		    .length = p->bounds[index + 1] - p->bounds[index],
+		};
+		if (!p->fn(p->user, chunk, index))
+			atomic_store_explicit(&p->stop, true,
+					      memory_order_relaxed);
+	}
+
+	return nullptr;
+}
+
+/* splits data into chunks of at least chunk_size ending after a delim */
+static size_t sio_chunk_bounds(const char *data, size_t len, size_t chunk_size,
+			       char delim, size_t **bounds)
+{
+	/* grow with the real chunk count, a lone delim may cover the file */
+	size_t capacity = 64;
+	size_t count = 0;
+	SIO_MALLOC(*bounds, capacity);
+
+	size_t pos = 0;
+	while (pos < len) {
+		if (count + 1 == capacity) {
+			capacity *= 2;
+			SIO_REALLOCARRAY(*bounds, capacity);
+		}
+		(*bounds)[count++] = pos;
+
+		if (len - pos <= chunk_size)
+			break;
+		const char *d =
+		    memchr(data + pos + chunk_size - 1, delim,
+			   len - pos - chunk_size + 1);
+		if (!d)
+			break;
+		pos = (size_t)(d - data) + 1;
+	}
+	(*bounds)[count] = len;
+
+	return count;
+}
+
+/*
+ * Maps file and runs fn over delim aligned chunks of it on nthreads
+ * threads, the calling thread included. nthreads == 0 uses one thread per
+ * online cpu. Returns 0 once every chunk ran, 1 if fn asked to stop and
+ * -errno if the file could not be mapped.
+ */
+int sio_parallel_for_chunks(struct sio_context *ctx, struct sio_file *file,
+			    size_t chunk_size, char delim, sio_chunk_fn fn,
+			    void *user, unsigned nthreads)
+{
+	assert(ctx);
+	assert(fn);
+	assert(chunk_size > 0);
+
+	if (!file || file->fd < 0)
+		return -EBADF;
+
+	const int fd = file->fd;
 	struct stat st;
 	if (fstat(fd, &st) == -1) {
+		const int err = errno;
 		perror("fstat");
 		fprintf(stderr, "Failed fstat for fd: %d\n", fd);
-		return nullptr;
+		return -err;
 	}
 	const size_t len = st.st_size;
 
 	/* empty file */
-	if (len == 0) {
-		struct sio_string *s = sio_string_new();
-		return s;
+	if (len == 0)
+		return 0;
+
+	/* chunk indices are packed into 32 bits, see SIO_RANGE_PACK */
+	if (len / chunk_size + 1 > UINT32_MAX) {
+		fprintf(stderr, "too many chunks for chunk_size: %zu\n",
+			chunk_size);
+		return -EOVERFLOW;
 	}
 
-	char *buf = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
-	if (buf == MAP_FAILED) {
+	char *data = mmap(0, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		const int err = errno;
 		perror("mmap");
 		fprintf(stderr, "Failed mmap for fd: %d\n", fd);
-		return nullptr;
+		return -err;
 	}
 
-	struct sio_string *file_contents = sio_string_new();
-	sio_string_copy_from_chars_with_length(file_contents, buf, len);
+	size_t *bounds = nullptr;
+	const size_t nchunks =
+	    sio_chunk_bounds(data, len, chunk_size, delim, &bounds);
 
-	assert(file_contents->length == len);
-	assert(file_contents->chars[file_contents->length] == '\0');
-	assert(file_contents->chars != buf);
+	if (nthreads == 0) {
+		const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? (unsigned)ncpu : 1;
+	}
+	if (nthreads > nchunks)
+		nthreads = (unsigned)nchunks;
 
-	munmap(buf, len);
-	return file_contents;
+	struct sio_parallel p = {
+	    .data = data,
+	    .bounds = bounds,
+	    .nchunks = nchunks,
+	    .fn = fn,
+	    .user = user,
+	    .nworkers = nthreads,
+	};
+	atomic_init(&p.stop, false);
+
+	/* contiguous ranges keep each worker streaming through the file */
+	SIO_MALLOC(p.workers, nthreads);
+	for (unsigned i = 0; i < nthreads; i++) {
+		struct sio_parallel_worker *w = &p.workers[i];
+		w->shared = &p;
+		w->id = i;
+		atomic_init(&w->range,
+			    SIO_RANGE_PACK(nchunks * i / nthreads,
+					   nchunks * (i + 1) / nthreads));
+	}
+
+	pthread_t *threads = nullptr;
+	SIO_MALLOC(threads, nthreads);
+	unsigned started = 1; /* worker 0 runs on the calling thread */
+	for (unsigned i = 1; i < nthreads; i++) {
+		const int ret = pthread_create(&threads[i], nullptr,
+					       sio_parallel_worker_run,
+					       &p.workers[i]);
+		if (ret != 0) {
+			/* remaining ranges get stolen by running workers */
+			fprintf(stderr, "pthread_create failed: errno=%d\n",
+				ret);
+			break;
+		}
+		started++;
+	}
+
+	sio_parallel_worker_run(&p.workers[0]);
+	for (unsigned i = 1; i < started; i++)
+		pthread_join(threads[i], nullptr);
+
+	const int ret = atomic_load(&p.stop) ? 1 : 0;
+
+	SIO_FREE(threads);
+	SIO_FREE(p.workers);
+	SIO_FREE(bounds);
+	munmap(data, len);
+	return ret;
 }
-#endif // SIO_USE_URING
 
-struct sio_file *sio_open(struct sio_context *ctx, struct sio_path *path,
-			  const char *mode)
+/* SIO_INDEX */
+#define SIO_INDEX_MAGIC 0x31305844494f4953ull /* "SIOIDX01" */
+#define SIO_INDEX_SUFFIX ".sioidx"
+
+struct sio_index_header {
+	uint64_t magic;
+	uint64_t file_size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t count;
+	uint64_t delim;
+	/* followed by count + 1 record start offsets, the last is file_size */
+};
+
+struct sio_index {
+	int fd;
+	char delim;
+	size_t file_size;
+	/* file mapping, published by the first sio_record_get to need it */
+	_Atomic(const char *) data;
+	size_t count;
+	const uint64_t *offsets;
+	void *table_map; /* sidecar mapping backing offsets, if any */
+	size_t table_map_len;
+	uint64_t *owned_offsets; /* used when the sidecar can't be written */
+};
+
+static bool sio_index_header_matches(const struct sio_index_header *h,
+				     const struct stat *st, char delim,
+				     size_t sidecar_len)
+{
+	if (h->magic != SIO_INDEX_MAGIC ||
+	    h->file_size != (uint64_t)st->st_size ||
+	    h->mtime_sec != (int64_t)st->st_mtim.tv_sec ||
+	    h->mtime_nsec != (int64_t)st->st_mtim.tv_nsec ||
+	    h->delim != (uint64_t)(unsigned char)delim)
+		return false;
+
+	/* bound count before multiplying so a huge value can't wrap */
+	const size_t slots = (sidecar_len - sizeof(*h)) / sizeof(uint64_t);
+	if (slots == 0 || h->count > slots - 1)
+		return false;
+	return sidecar_len == sizeof(*h) + (h->count + 1) * sizeof(uint64_t);
+}
+
+/* a table is only usable if every span it yields lies inside the file */
+static bool sio_index_offsets_valid(const uint64_t *offsets, uint64_t count,
+				    uint64_t file_size)
+{
+	if (offsets[0] != 0 || offsets[count] != file_size)
+		return false;
+	for (uint64_t i = 1; i <= count; i++) {
+		if (offsets[i] < offsets[i - 1])
+			return false;
+	}
+	return true;
+}
+
+/* maps a valid sidecar into index, false if it is missing or stale */
+static bool sio_index_load(struct sio_index *index, const char *sidecar,
+			   const struct stat *st)
+{
+	const int fd = open(sidecar, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	struct stat sst;
+	if (fstat(fd, &sst) == -1 ||
+	    (size_t)sst.st_size < sizeof(struct sio_index_header)) {
+		close(fd);
+		return false;
+	}
+
+	const size_t len = sst.st_size;
+	void *map = mmap(0, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	const struct sio_index_header *h = map;
+	if (!sio_index_header_matches(h, st, index->delim, len) ||
+	    !sio_index_offsets_valid((const uint64_t *)(h + 1), h->count,
+				     h->file_size)) {
+		munmap(map, len);
+		return false;
+	}
+
+	index->table_map = map;
+	index->table_map_len = len;
+	index->count = h->count;
+	index->offsets = (const uint64_t *)(h + 1);
+	return true;
+}
+
+static bool sio_write_all(int fd, const void *data, size_t length)
+{
+	const char *p = data;
+	while (length > 0) {
+		const ssize_t ret = write(fd, p, length);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += ret;
+		length -= ret;
+	}
+	return true;
+}
+
+/*
+ * Writes to a uniquely named temporary file first, so neither readers nor
+ * concurrent writers ever see a partial table.
+ */
+static void sio_index_store(const struct sio_index *index, const char *sidecar,
+			    const struct stat *st)
+{
+	const struct sio_index_header h = {
+	    .magic = SIO_INDEX_MAGIC,
+	    .file_size = (uint64_t)st->st_size,
+	    .mtime_sec = (int64_t)st->st_mtim.tv_sec,
+	    .mtime_nsec = (int64_t)st->st_mtim.tv_nsec,
+	    .count = index->count,
+	    .delim = (uint64_t)(unsigned char)index->delim,
+	};
+
+	const size_t sidecar_len = strlen(sidecar);
+	char *tmp = nullptr;
+	SIO_MALLOC(tmp, sidecar_len + sizeof(".XXXXXX"));
+	memcpy(tmp, sidecar, sidecar_len);
+	memcpy(tmp + sidecar_len, ".XXXXXX", sizeof(".XXXXXX"));
+
+	const int fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd == -1) {
+		SIO_FREE(tmp);
+		return; /* read-only location, keep the table in memory */
+	}
+
+	const bool ok =
+	    fchmod(fd, 0644) == 0 && sio_write_all(fd, &h, sizeof(h)) &&
+	    sio_write_all(fd, index->offsets,
+			  (index->count + 1) * sizeof(uint64_t));
+	close(fd);
+
+	if (!ok || rename(tmp, sidecar) == -1) {
+		fprintf(stderr, "Failed to write index: %s\n", sidecar);
+		remove(tmp);
+	}
+	SIO_FREE(tmp);
+}
+
+/* one pass over the mapped file, memchr does the vectorized scanning */
+static void sio_index_build(struct sio_index *index)
+{
+	size_t capacity = 1024;
+	size_t count = 0;
+	uint64_t *offsets = nullptr;
+	SIO_MALLOC(offsets, capacity);
+
+	const char *data = atomic_load(&index->data);
+	const char *p = data;
+	const char *end = data + index->file_size;
+	while (p < end) {
+		if (count + 1 == capacity) {
+			capacity *= 2;
+			SIO_REALLOCARRAY(offsets, capacity);
+		}
+		offsets[count++] = (uint64_t)(p - data);
+
+		const char *d = memchr(p, index->delim, end - p);
+		if (!d)
+			break;
+		p = d + 1;
+	}
+	offsets[count] = (uint64_t)index->file_size;
+
+	index->count = count;
+	index->offsets = offsets;
+	index->owned_offsets = offsets;
+}
+
+/* maps the data file once, racing callers keep the first mapping */
+static const char *sio_index_data(struct sio_index *index)
+{
+	const char *data =
+	    atomic_load_explicit(&index->data, memory_order_acquire);
+	if (data)
+		return data;
+
+	char *map = mmap(0, index->file_size, PROT_READ, MAP_SHARED,
+			 index->fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		fprintf(stderr, "Failed mmap for fd: %d\n", index->fd);
+		return nullptr;
+	}
+
+	if (!atomic_compare_exchange_strong_explicit(
+		&index->data, &data, map, memory_order_acq_rel,
+		memory_order_acquire)) {
+		munmap(map, index->file_size);
+		return data;
+	}
+	return map;
+}
+
+struct sio_index *sio_index_open(struct sio_context *ctx, struct sio_path *path,
+				 char delim)
 {
 	assert(ctx);
 	assert(path);
 	assert(path->path_str.length != 0);
 	assert(path->path_str.chars != nullptr);
-	assert(path->path_str.chars[path->path_str.length] == '\0');
 
-	struct sio_file *file = sio_file_new();
-	FILE *f = fopen(path->path_str.chars, mode);
-	if (!f) {
-		sio_file_free(file);
-		fprintf(stderr, "fopen failed for path: %s\n",
-			path->path_str.chars);
+	const int fd = sio_openat_fd(ctx, AT_FDCWD, path->path_str.chars,
+				     O_RDONLY | O_CLOEXEC, SIO_RESOLVE_NONE);
+	if (fd < 0) {
+		fprintf(stderr, "open failed for path: %s, errno=%d\n",
+			path->path_str.chars, -fd);
 		return nullptr;
 	}
 
-	file->file = f;
-	return file;
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		perror("fstat");
+		fprintf(stderr, "Failed fstat for fd: %d\n", fd);
+		close(fd);
+		return nullptr;
+	}
+
+	struct sio_index *index = nullptr;
+	SIO_CALLOC(index, 1);
+	index->fd = fd;
+	index->delim = delim;
+	index->file_size = st.st_size;
+
+	char *sidecar = nullptr;
+	SIO_MALLOC(sidecar, path->path_str.length + sizeof(SIO_INDEX_SUFFIX));
+	memcpy(sidecar, path->path_str.chars, path->path_str.length);
+	memcpy(sidecar + path->path_str.length, SIO_INDEX_SUFFIX,
+	       sizeof(SIO_INDEX_SUFFIX));
+
+	if (!sio_index_load(index, sidecar, &st)) {
+		if (index->file_size != 0 && !sio_index_data(index)) {
+			SIO_FREE(sidecar);
+			sio_index_close(index);
+			return nullptr;
+		}
+		sio_index_build(index);
+		sio_index_store(index, sidecar, &st);
+	}
+
+	SIO_FREE(sidecar);
+	return index;
 }
 
-void sio_close(struct sio_context *ctx, struct sio_file *file)
+void sio_index_close(struct sio_index *index)
+{
+	if (!index)
+		return;
+
+	const char *data = atomic_load(&index->data);
+	if (data)
+		munmap((void *)data, index->file_size);
+	if (index->table_map)
+		munmap(index->table_map, index->table_map_len);
+	SIO_FREE(index->owned_offsets);
+	close(index->fd);
+	SIO_FREE(index);
+}
+
+size_t sio_index_count(const struct sio_index *index)
+{
+	assert(index);
+	return index->count;
+}
+
+/*
+ * Returns record n without its delimiter, pointing into the mapped file.
+ * chars is nullptr when n is out of range or the file can't be mapped.
+ */
+struct sio_span sio_record_get(struct sio_index *index, size_t n)
+{
+	assert(index);
+
+	struct sio_span span = {.chars = nullptr, .length = 0};
+	if (n >= index->count)
+		return span;
+
+	const char *data = sio_index_data(index);
+	if (!data)
+		return span;
+
+	const uint64_t begin = index->offsets[n];
+	const uint64_t end = index->offsets[n + 1];
+	span.chars = data + begin;
+	span.length = end - begin;
+	if (span.length > 0 && span.chars[span.length - 1] == index->delim)
+		span.length--;
+	return span;
+}
+
+/* SIO_LOG */
+struct sio_log_slot {
+	/* slot is free for ticket n when seq == n, ready when seq == n + 1 */
+	atomic_size_t seq;
+	const void *data;
+	size_t length;
+	sio_log_done_fn done;
+	void *user;
+};
+
+struct sio_log {
+	struct sio_context *ctx;
+	int fd;
+	uint64_t offset;
+	size_t mask;
+	struct sio_log_slot *slots;
+	struct iovec *iov;
+	atomic_size_t tail; /* next ticket handed to an appender */
+	size_t head;	    /* next ticket to flush, owned by the flusher */
+};
+
+/* fsyncs the directory holding path, 0 or -errno */
+static int sio_fsync_parent(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	char *dir = nullptr;
+	if (!slash) {
+		SIO_MALLOC(dir, 2);
+		memcpy(dir, ".", 2);
+	} else {
+		/* keep the root slash for files directly under / */
+		const size_t len = slash == path ? 1 : (size_t)(slash - path);
+		SIO_MALLOC(dir, len + 1);
+		memcpy(dir, path, len);
+		dir[len] = '\0';
+	}
+
+	int ret = 0;
+	const int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1 || fsync(fd) == -1)
+		ret = -errno;
+	if (fd != -1)
+		close(fd);
+	SIO_FREE(dir);
+	return ret;
+}
+
+struct sio_log *sio_log_open(struct sio_context *ctx, struct sio_path *path,
+			     size_t capacity)
 {
 	assert(ctx);
-	sio_file_free(file);
+	assert(path);
+	assert(path->path_str.chars != nullptr);
+	assert(capacity > 0);
+
+	const char *p = path->path_str.chars;
+	int fd = sio_openat_fd(ctx, AT_FDCWD, p, O_WRONLY | O_CLOEXEC,
+			       SIO_RESOLVE_NONE);
+	if (fd == -ENOENT) {
+		/* a new journal is only durable once its dir entry is */
+		fd = sio_openat_fd(ctx, AT_FDCWD, p,
+				   O_WRONLY | O_CREAT | O_CLOEXEC,
+				   SIO_RESOLVE_NONE);
+		if (fd >= 0 && sio_fsync_parent(p) != 0) {
+			fprintf(stderr, "fsync of log dir failed: %s\n", p);
+			close(fd);
+			return nullptr;
+		}
+	}
+	if (fd < 0) {
+		fprintf(stderr, "open log failed for path: %s, errno=%d\n", p,
+			-fd);
+		return nullptr;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		perror("fstat");
+		close(fd);
+		return nullptr;
+	}
+
+	/* round up to a power of two so tickets map to slots with a mask */
+	size_t slots = 1;
+	while (slots < capacity)
+		slots <<= 1;
+
+	struct sio_log *log = nullptr;
+	SIO_MALLOC(log, 1);
+	log->ctx = ctx;
+	log->fd = fd;
+	log->offset = (uint64_t)st.st_size;
+	log->mask = slots - 1;
+	SIO_MALLOC(log->slots, slots);
+	SIO_MALLOC(log->iov, slots < IOV_MAX ? slots : IOV_MAX);
+	for (size_t i = 0; i < slots; i++)
+		atomic_init(&log->slots[i].seq, i);
+	atomic_init(&log->tail, 0);
+	log->head = 0;
+
+	return log;
+}
+
+void sio_log_close(struct sio_log *log)
+{
+	if (!log)
+		return;
+
+	sio_log_flush(log);
+	close(log->fd);
+	SIO_FREE(log->iov);
+	SIO_FREE(log->slots);
+	SIO_FREE(log);
+}
+
+/*
+ * Stages a record without taking a lock. data is not copied and must stay
+ * valid until done is called, so done is required. Returns false when the
+ * staging buffer is full, the caller should wait for the next flush and
+ * retry.
+ */
+bool sio_log_append(struct sio_log *log, const void *data, size_t length,
+		    sio_log_done_fn done, void *user)
+{
+	assert(log);
+	assert(data || length == 0);
+	assert(done);
+
+	size_t pos = atomic_load_explicit(&log->tail, memory_order_relaxed);
+	for (;;) {
+		struct sio_log_slot *slot = &log->slots[pos & log->mask];
+		const size_t seq =
+		    atomic_load_explicit(&slot->seq, memory_order_acquire);
+		const intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+		if (dif == 0) {
+			if (atomic_compare_exchange_weak_explicit(
+				&log->tail, &pos, pos + 1,
+				memory_order_relaxed, memory_order_relaxed)) {
+				slot->data = data;
+				slot->length = length;
+				slot->done = done;
+				slot->user = user;
+				atomic_store_explicit(&slot->seq, pos + 1,
+						      memory_order_release);
+				return true;
+			}
+		} else if (dif < 0) {
+			return false; /* slot still holds an unflushed record */
+		} else {
+			pos = atomic_load_explicit(&log->tail,
+						   memory_order_relaxed);
+		}
+	}
+}
+
+static void sio_iov_advance(struct iovec **iov, int *count, size_t bytes)
+{
+	while (*count > 0 && bytes >= (*iov)->iov_len) {
+		bytes -= (*iov)->iov_len;
+		(*iov)++;
+		(*count)--;
+	}
+	if (*count > 0) {
+		(*iov)->iov_base = (char *)(*iov)->iov_base + bytes;
+		(*iov)->iov_len -= bytes;
+	}
+}
+
+#ifdef SIO_USE_URING
+/* writes all of iov and issues one fdatasync linked behind it */
+static int sio_log_write_sync(struct sio_log *log, struct iovec *iov,
+			      int count)
+{
+	struct io_uring *ring = &log->ctx->ring;
+	if (log->ctx->ring_failed)
+		return -EIO;
+
+	while (count > 0) {
+		/*
+		 * The pair must go out in one submission, a writev submitted
+		 * alone would leave the fdatasync unordered behind it.
+		 */
+		if (io_uring_sq_space_left(ring) < 2)
+			io_uring_submit(ring);
+		if (io_uring_sq_space_left(ring) < 2) {
+			fprintf(stderr, "Failed to get sqe entries\n");
+			return -EBUSY;
+		}
+
+		struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+		io_uring_prep_writev(sqe, log->fd, iov, count, log->offset);
+		io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+		io_uring_sqe_set_data64(sqe, 0);
+
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_fsync(sqe, log->fd, IORING_FSYNC_DATASYNC);
+		io_uring_sqe_set_data64(sqe, 1);
+
+		int ret = io_uring_submit_and_wait(ring, 2);
+		if (ret < 0) {
+			fprintf(stderr, "Failed sqe submit, errno: %d\n", ret);
+			return ret;
+		}
+
+		int write_res = 0;
+		int sync_res = 0;
+		for (int i = 0; i < 2; i++) {
+			struct io_uring_cqe *cqe = nullptr;
+			ret = io_uring_wait_cqe(ring, &cqe);
+			if (ret < 0)
+				return ret;
+			if (io_uring_cqe_get_data64(cqe) == 0)
+				write_res = cqe->res;
+			else
+				sync_res = cqe->res;
+			io_uring_cqe_seen(ring, cqe);
+		}
+
+		if (write_res < 0)
+			return write_res;
+
+		size_t remaining = 0;
+		for (int i = 0; i < count; i++)
+			remaining += iov[i].iov_len;
+
+		log->offset += (uint64_t)write_res;
+		if ((size_t)write_res == remaining)
+			return sync_res;
+		if (write_res == 0)
+			return -EIO; /* no progress, retrying would spin */
+
+		/* short write severs the link, write the rest and sync again */
+		sio_iov_advance(&iov, &count, (size_t)write_res);
+	}
+
+	return 0;
+}
+#else // SIO_USE_URING
+/* writes all of iov and issues one fdatasync behind it */
+static int sio_log_write_sync(struct sio_log *log, struct iovec *iov,
+			      int count)
+{
+	sio_iov_advance(&iov, &count, 0); /* skip empty records */
+	while (count > 0) {
+		const ssize_t ret =
+		    pwritev(log->fd, iov, count, (off_t)log->offset);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (ret == 0)
+			return -EIO; /* no progress, retrying would spin */
+		log->offset += (uint64_t)ret;
+		sio_iov_advance(&iov, &count, (size_t)ret);
+	}
+
+	return fdatasync(log->fd) == -1 ? -errno : 0;
+}
+#endif // SIO_USE_URING
+
+/*
+ * Writes every staged record in vectored batches, each followed by a single
+ * fdatasync, then reports completion per record. Once a batch fails the
+ * records staged after it are completed with the same error unwritten, so
+ * appends are never left behind a gap. Returns the number of records made
+ * durable, or -errno if a batch failed.
+ */
+int sio_log_flush(struct sio_log *log)
+{
+	assert(log);
+
+	const size_t max_batch = log->mask + 1 < IOV_MAX ? log->mask + 1
+							 : IOV_MAX;
+	int flushed = 0;
+	int err = 0;
+
+	/* bound the work to one pass so busy appenders can't starve us */
+	const size_t end = log->head + log->mask + 1;
+	while (log->head != end) {
+		size_t count = 0;
+		while (count < max_batch && log->head + count != end) {
+			const size_t pos = log->head + count;
+			struct sio_log_slot *slot =
+			    &log->slots[pos & log->mask];
+			if (atomic_load_explicit(&slot->seq,
+						 memory_order_acquire) !=
+			    pos + 1)
+				break;
+			log->iov[count].iov_base = (void *)slot->data;
+			log->iov[count].iov_len = slot->length;
+			count++;
+		}
+
+		if (count == 0)
+			break;
+
+		const int res =
+		    err ? err : sio_log_write_sync(log, log->iov, (int)count);
+
+		for (size_t i = 0; i < count; i++) {
+			const size_t pos = log->head + i;
+			struct sio_log_slot *slot =
+			    &log->slots[pos & log->mask];
+			slot->done(slot->user, res);
+			atomic_store_explicit(&slot->seq, pos + log->mask + 1,
+					      memory_order_release);
+		}
+		log->head += count;
+
+		if (res < 0 && !err) {
+			fprintf(stderr, "log write failed: errno=%d\n", -res);
+			err = res;
+		}
+		if (!err)
+			flushed += (int)count;
+	}
+
+	return err ? err : flushed;
 }
@@ -0,0 +1,575 @@
+#include "unity.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sio/sio.h>
+
+/*
+ * Stress and scaling tests, built with SIO_BUILD_STRESS against the fault
+ * injecting sio_fault library. Sizes can be tuned with:
+ *   SIO_STRESS_FILES        number of files in the batched reads (4096)
+ *   SIO_STRESS_MAX_THREADS  largest thread count in the scaling curves
+ */
+
+#define STRESS_DIR "stress_sio_linux_dir"
+#define GIB ((size_t)1 << 30)
+
+static size_t env_size(const char *name, size_t fallback)
+{
+	const char *v = getenv(name);
+	if (!v || *v == '\0')
+		return fallback;
+	return (size_t)strtoull(v, nullptr, 10);
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static unsigned max_threads(void)
+{
+	const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t fallback = ncpu > 0 ? (size_t)ncpu * 2 : 2;
+	if (fallback < 4)
+		fallback = 4;
+	if (fallback > 16)
+		fallback = 16;
+	return (unsigned)env_size("SIO_STRESS_MAX_THREADS", fallback);
+}
+
+/* free memory, ignoring the page cache, with some headroom left over */
+static bool have_memory_for(size_t bytes)
+{
+	const long pages = sysconf(_SC_AVPHYS_PAGES);
+	const long page = sysconf(_SC_PAGESIZE);
+	return pages > 0 && page > 0 &&
+	       (size_t)pages * (size_t)page > bytes + bytes / 4;
+}
+
+/* a hole of size bytes with marker written at its start and its end */
+static bool write_sparse_file(const char *path, size_t size,
+			      const char *marker)
+{
+	const size_t mlen = strlen(marker);
+	const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		perror("open");
+		return false;
+	}
+
+	bool ok = ftruncate(fd, (off_t)size) == 0 &&
+		  pwrite(fd, marker, mlen, 0) == (ssize_t)mlen &&
+		  pwrite(fd, marker, mlen, (off_t)(size - mlen)) ==
+		      (ssize_t)mlen;
+	close(fd);
+	return ok;
+}
+
+static void file_path(char *buf, size_t len, size_t i)
+{
+	snprintf(buf, len, STRESS_DIR "/f%05zu.txt", i);
+}
+
+/* deterministic content whose length varies per file */
+static size_t file_content(size_t i, char *buf, size_t cap)
+{
+	const size_t len = (i * 7919) % (cap - 1) + 1;
+	for (size_t j = 0; j < len; j++)
+		buf[j] = (char)('a' + (i + j) % 26);
+	return len;
+}
+
+static bool write_files(size_t count)
+{
+	mkdir(STRESS_DIR, 0755);
+	char path[64];
+	char content[4096];
+	for (size_t i = 0; i < count; i++) {
+		file_path(path, sizeof(path), i);
+		const size_t len = file_content(i, content, sizeof(content));
+		FILE *f = fopen(path, "w");
+		if (!f)
+			return false;
+		const bool ok = fwrite(content, 1, len, f) == len;
+		if (fclose(f) != 0 || !ok)
+			return false;
+	}
+	return true;
+}
+
+static void remove_files(size_t count)
+{
+	char path[64];
+	for (size_t i = 0; i < count; i++) {
+		file_path(path, sizeof(path), i);
+		remove(path);
+	}
+	rmdir(STRESS_DIR);
+}
+
+/* how many files we may keep open at once, raising the soft limit */
+static size_t open_file_budget(size_t wanted)
+{
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) != 0)
+		return 256;
+	if (rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		getrlimit(RLIMIT_NOFILE, &rl);
+	}
+	const size_t budget = rl.rlim_cur > 128 ? rl.rlim_cur - 64 : 64;
+	return wanted < budget ? wanted : budget;
+}
+
+void setUp(void)
+{
+}
+void tearDown(void)
+{
+}
+
+/* LARGE FILES */
+static void read_sparse(size_t size)
+{
+	const char *test_path = "stress_sio_linux_sparse.bin";
+	const char *marker = "sio-marker";
+	const size_t mlen = strlen(marker);
+
+	if (!have_memory_for(size)) {
+		remove(test_path);
+		TEST_IGNORE_MESSAGE("not enough free memory for this read");
+	}
+	TEST_ASSERT_TRUE(write_sparse_file(test_path, size, marker));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+
+	struct sio_file file;
+	TEST_ASSERT_TRUE(sio_open_cstr(ctx, test_path, "r", &file));
+
+	struct sio_string content = {.length = 0, .chars = nullptr};
+	const double start = now_seconds();
+	TEST_ASSERT_TRUE(sio_read_file_into(ctx, &file, &content));
+	const double secs = now_seconds() - start;
+
+	TEST_ASSERT_EQUAL_UINT64(content.length, size);
+	TEST_ASSERT_EQUAL_MEMORY(content.chars, marker, mlen);
+	TEST_ASSERT_EQUAL_MEMORY(content.chars + size - mlen, marker, mlen);
+	TEST_ASSERT_EQUAL(content.chars[size], '\0');
+	printf("read %zu bytes in %.2fs, %.0f MiB/s\n", size, secs,
+	       (double)size / (1 << 20) / secs);
+
+	free(content.chars);
+	sio_file_close(ctx, &file);
+	sio_context_destroy(ctx);
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+void test_read_above_2gib(void)
+{
+	read_sparse(2 * GIB + 4097);
+}
+
+void test_read_above_4gib(void)
+{
+	read_sparse(4 * GIB + 4097);
+}
+
+struct sparse_stats {
+	atomic_size_t bytes;
+	atomic_size_t chunks;
+};
+
+static bool count_sparse(void *user, struct sio_span chunk, size_t index)
+{
+	struct sparse_stats *stats = user;
+	(void)index;
+	atomic_fetch_add(&stats->bytes, chunk.length);
+	atomic_fetch_add(&stats->chunks, 1);
+	return true;
+}
+
+/* mapped chunks past 4 GiB without holding the file in memory */
+void test_chunks_above_4gib(void)
+{
+	const char *test_path = "stress_sio_linux_sparse.bin";
+	const size_t size = 4 * GIB + 4097;
+	TEST_ASSERT_TRUE(write_sparse_file(test_path, size, "x"));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_file file;
+	TEST_ASSERT_TRUE(sio_open_cstr(ctx, test_path, "r", &file));
+
+	/* the hole reads as zeros, so '\0' splits it into exact chunks */
+	const size_t chunk_size = 64 << 20;
+	struct sparse_stats stats = {0};
+	TEST_ASSERT_EQUAL(sio_parallel_for_chunks(ctx, &file, chunk_size, '\0',
+						  count_sparse, &stats, 0),
+			  0);
+	TEST_ASSERT_EQUAL_UINT64(atomic_load(&stats.bytes), size);
+	TEST_ASSERT_EQUAL_UINT64(atomic_load(&stats.chunks),
+				 (size + chunk_size - 1) / chunk_size);
+
+	sio_file_close(ctx, &file);
+	sio_context_destroy(ctx);
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+/* BATCHED READS */
+static void batched_reads(const struct sio_fault *fault, const char *label)
+{
+	const size_t count =
+	    open_file_budget(env_size("SIO_STRESS_FILES", 4096));
+	TEST_ASSERT_TRUE(write_files(count));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	sio_context_set_fault(ctx, fault);
+
+	struct sio_file *files = calloc(count, sizeof(*files));
+	struct sio_string *contents = calloc(count, sizeof(*contents));
+	TEST_ASSERT_NOT_NULL(files);
+	TEST_ASSERT_NOT_NULL(contents);
+
+	char path[64];
+	for (size_t i = 0; i < count; i++) {
+		file_path(path, sizeof(path), i);
+		TEST_ASSERT_TRUE(sio_open_cstr(ctx, path, "r", &files[i]));
+	}
+
+	const double start = now_seconds();
+	TEST_ASSERT_TRUE(sio_read_files_into(ctx, files, count, contents));
+	const double secs = now_seconds() - start;
+
+	char expected[4096];
+	size_t bytes = 0;
+	for (size_t i = 0; i < count; i++) {
+		const size_t len = file_content(i, expected, sizeof(expected));
+		TEST_ASSERT_EQUAL_UINT64(contents[i].length, len);
+		TEST_ASSERT_EQUAL_MEMORY(contents[i].chars, expected, len);
+		bytes += len;
+		free(contents[i].chars);
+		sio_file_close(ctx, &files[i]);
+	}
+	printf("%s: %zu files, %zu bytes in %.3fs\n", label, count, bytes,
+	       secs);
+
+	free(contents);
+	free(files);
+	sio_context_destroy(ctx);
+	remove_files(count);
+}
+
+void test_batched_reads(void)
+{
+	const struct sio_fault none = {0};
+	batched_reads(&none, "batched");
+}
+
+void test_batched_reads_faults(void)
+{
+	/* every 5th sqe grab sees a full sq, reads are split and cut short */
+	const struct sio_fault fault = {
+	    .max_io = 1000,
+	    .busy_every = 5,
+	    .short_read_every = 3,
+	};
+	batched_reads(&fault, "batched with faults");
+}
+
+void test_short_reads_large(void)
+{
+	const char *test_path = "stress_sio_linux.bin";
+	const size_t size = 8 << 20;
+
+	char *data = malloc(size);
+	TEST_ASSERT_NOT_NULL(data);
+	for (size_t i = 0; i < size; i++)
+		data[i] = (char)(i * 2654435761u >> 24);
+	FILE *f = fopen(test_path, "wb");
+	TEST_ASSERT_NOT_NULL(f);
+	TEST_ASSERT_EQUAL(fwrite(data, 1, size, f), size);
+	TEST_ASSERT_EQUAL(fclose(f), 0);
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	const struct sio_fault fault = {
+	    .max_io = 4093,
+	    .busy_every = 3,
+	    .short_read_every = 2,
+	};
+	sio_context_set_fault(ctx, &fault);
+
+	struct sio_file file;
+	TEST_ASSERT_TRUE(sio_open_cstr(ctx, test_path, "r", &file));
+	struct sio_string content = {.length = 0, .chars = nullptr};
+	TEST_ASSERT_TRUE(sio_read_file_into(ctx, &file, &content));
+	TEST_ASSERT_EQUAL_UINT64(content.length, size);
+	TEST_ASSERT_EQUAL_MEMORY(content.chars, data, size);
+
+	free(content.chars);
+	free(data);
+	sio_file_close(ctx, &file);
+	sio_context_destroy(ctx);
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+/* SCALING */
+struct reader_args {
+	size_t count;
+	size_t rounds;
+	size_t bytes;
+	bool ok;
+};
+
+/* one context per thread, contexts are not shared between threads */
+static void *reader_thread(void *arg)
+{
+	struct reader_args *a = arg;
+	struct sio_context *ctx = sio_context_init();
+	if (!ctx)
+		return nullptr;
+
+	a->ok = true;
+	char path[64];
+	for (size_t r = 0; r < a->rounds; r++) {
+		for (size_t i = 0; i < a->count; i++) {
+			file_path(path, sizeof(path), i);
+			struct sio_file file;
+			if (!sio_open_cstr(ctx, path, "r", &file)) {
+				a->ok = false;
+				continue;
+			}
+			struct sio_string content = {.length = 0,
+						     .chars = nullptr};
+			if (sio_read_file_into(ctx, &file, &content))
+				a->bytes += content.length;
+			else
+				a->ok = false;
+			free(content.chars);
+			sio_file_close(ctx, &file);
+		}
+	}
+
+	sio_context_destroy(ctx);
+	return nullptr;
+}
+
+void test_scaling_contexts(void)
+{
+	const size_t count = 512;
+	const size_t rounds = 8;
+	TEST_ASSERT_TRUE(write_files(count));
+
+	const unsigned nmax = max_threads();
+	pthread_t *threads = calloc(nmax, sizeof(*threads));
+	struct reader_args *args = calloc(nmax, sizeof(*args));
+	TEST_ASSERT_NOT_NULL(threads);
+	TEST_ASSERT_NOT_NULL(args);
+
+	printf("open+read+close, one context per thread\n");
+	printf("threads  files/s     MiB/s  speedup\n");
+	double base = 0;
+	for (unsigned n = 1; n <= nmax; n *= 2) {
+		const double start = now_seconds();
+		for (unsigned t = 0; t < n; t++) {
+			args[t] = (struct reader_args){.count = count,
+						       .rounds = rounds};
+			TEST_ASSERT_EQUAL(pthread_create(&threads[t], nullptr,
+							 reader_thread,
+							 &args[t]),
+					  0);
+		}
+		size_t bytes = 0;
+		for (unsigned t = 0; t < n; t++) {
+			pthread_join(threads[t], nullptr);
+			TEST_ASSERT_TRUE(args[t].ok);
+			bytes += args[t].bytes;
+		}
+		const double secs = now_seconds() - start;
+
+		const double files = (double)(count * rounds * n) / secs;
+		if (base == 0)
+			base = files;
+		printf("%7u %8.0f %9.1f %8.2f\n", n, files,
+		       (double)bytes / (1 << 20) / secs, files / base);
+	}
+
+	free(args);
+	free(threads);
+	remove_files(count);
+}
+
+static bool sum_chunk(void *user, struct sio_span chunk, size_t index)
+{
+	atomic_size_t *sum = user;
+	(void)index;
+
+	size_t s = 0;
+	for (size_t i = 0; i < chunk.length; i++)
+		s += (unsigned char)chunk.chars[i];
+	atomic_fetch_add(sum, s);
+	return true;
+}
+
+void test_scaling_parallel_chunks(void)
+{
+	const char *test_path = "stress_sio_linux.bin";
+	const size_t size = 256 << 20;
+
+	FILE *f = fopen(test_path, "wb");
+	TEST_ASSERT_NOT_NULL(f);
+	char line[64];
+	size_t written = 0;
+	size_t expected = 0;
+	for (size_t i = 0; written < size; i++) {
+		const int len = snprintf(line, sizeof(line), "%zu,%zu\n", i,
+					 i * 31);
+		TEST_ASSERT_EQUAL(fwrite(line, 1, (size_t)len, f), (size_t)len);
+		for (int j = 0; j < len; j++)
+			expected += (unsigned char)line[j];
+		written += (size_t)len;
+	}
+	TEST_ASSERT_EQUAL(fclose(f), 0);
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_file file;
+	TEST_ASSERT_TRUE(sio_open_cstr(ctx, test_path, "r", &file));
+
+	printf("sio_parallel_for_chunks over %zu bytes\n", written);
+	printf("threads     MiB/s  speedup\n");
+	double base = 0;
+	for (unsigned n = 1; n <= max_threads(); n *= 2) {
+		atomic_size_t sum = 0;
+		const double start = now_seconds();
+		TEST_ASSERT_EQUAL(sio_parallel_for_chunks(ctx, &file, 1 << 20,
+							  '\n', sum_chunk, &sum,
+							  n),
+				  0);
+		const double secs = now_seconds() - start;
+		TEST_ASSERT_EQUAL_UINT64(atomic_load(&sum), expected);
+
+		const double rate = (double)written / (1 << 20) / secs;
+		if (base == 0)
+			base = rate;
+		printf("%7u %9.1f %8.2f\n", n, rate, rate / base);
+	}
+
+	sio_file_close(ctx, &file);
+	sio_context_destroy(ctx);
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+/* MULTI-THREADED LOG */
+struct appender_args {
+	struct sio_log *log;
+	size_t records;
+	atomic_size_t *done;
+};
+
+static void count_durable(void *user, int res)
+{
+	if (res == 0)
+		atomic_fetch_add((atomic_size_t *)user, 1);
+}
+
+static void *appender_thread(void *arg)
+{
+	struct appender_args *a = arg;
+	for (size_t i = 0; i < a->records; i++) {
+		while (!sio_log_append(a->log, "record\n", 7, count_durable,
+				       a->done))
+			sched_yield(); /* staging full, wait for the flusher */
+	}
+	return nullptr;
+}
+
+void test_log_appenders(void)
+{
+	const char *test_path = "stress_sio_linux.log";
+	remove(test_path);
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_path path = sio_path_view(test_path);
+	struct sio_log *log = sio_log_open(ctx, &path, 1024);
+	TEST_ASSERT_NOT_NULL(log);
+
+	const unsigned n = max_threads();
+	const size_t records = 20000;
+	atomic_size_t done = 0;
+	pthread_t *threads = calloc(n, sizeof(*threads));
+	struct appender_args *args = calloc(n, sizeof(*args));
+	TEST_ASSERT_NOT_NULL(threads);
+	TEST_ASSERT_NOT_NULL(args);
+
+	const double start = now_seconds();
+	for (unsigned t = 0; t < n; t++) {
+		args[t] = (struct appender_args){
+		    .log = log, .records = records, .done = &done};
+		TEST_ASSERT_EQUAL(pthread_create(&threads[t], nullptr,
+						 appender_thread, &args[t]),
+				  0);
+	}
+
+	size_t groups = 0;
+	while (atomic_load(&done) < records * n) {
+		const int ret = sio_log_flush(log);
+		TEST_ASSERT_GREATER_OR_EQUAL(0, ret);
+		groups += ret > 0;
+	}
+	for (unsigned t = 0; t < n; t++)
+		pthread_join(threads[t], nullptr);
+	const double secs = now_seconds() - start;
+
+	sio_log_close(log);
+	printf("%u appenders: %zu records in %zu flushes, %.0f records/s\n", n,
+	       records * n, groups, (double)(records * n) / secs);
+
+	struct stat st;
+	TEST_ASSERT_EQUAL(stat(test_path, &st), 0);
+	TEST_ASSERT_EQUAL_UINT64(st.st_size, records * n * 7);
+
+	free(args);
+	free(threads);
+	sio_context_destroy(ctx);
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+int main(void)
+{
+	UNITY_BEGIN();
+
+	/* LARGE FILES */
+	RUN_TEST(test_read_above_2gib);
+	RUN_TEST(test_read_above_4gib);
+	RUN_TEST(test_chunks_above_4gib);
+
+	/* BATCHED READS */
+	RUN_TEST(test_batched_reads);
+	RUN_TEST(test_batched_reads_faults);
+	RUN_TEST(test_short_reads_large);
+
+	/* SCALING */
+	RUN_TEST(test_scaling_contexts);
+	RUN_TEST(test_scaling_parallel_chunks);
+
+	/* MULTI-THREADED LOG */
+	RUN_TEST(test_log_appenders);
+
+	return UNITY_END();
+}
@@ -1,5 +1,11 @@
 #include "unity.h"
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <sio/sio.h>
 
 void setUp(void)
@@ -9,6 +15,31 @@ void tearDown(void)
 {
 }
 
+/* heap allocations made by the library, counted via -Wl,--wrap */
+static size_t nallocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	nallocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	nallocs++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	nallocs++;
+	return __real_realloc(ptr, size);
+}
+
 static bool write_test_file(const char *path, const char *content)
 {
 	FILE *f = fopen(path, "w");
@@ -140,6 +171,15 @@ void test_sio_path_from_c_str(void)
 	sio_path_free(path);
 }
 
+void test_sio_path_view(void)
+{
+	const char *data = "/this/is/a//path";
+	struct sio_path path = sio_path_view(data);
+
+	TEST_ASSERT_EQUAL(path.path_str.length, strlen(data));
+	TEST_ASSERT_EQUAL(path.path_str.chars, data);
+}
+
 /* SIO_FILE */
 void test_open_non_existent(void)
 {
@@ -170,7 +210,7 @@ void test_read_small(void)
 
 	struct sio_file *file = sio_open(ctx, path, "r");
 	TEST_ASSERT_NOT_NULL(file);
-	TEST_ASSERT_NOT_NULL(file->file);
+	TEST_ASSERT_GREATER_OR_EQUAL(0, file->fd);
 
 	struct sio_string *read_content = sio_read_file(ctx, file);
 	TEST_ASSERT_NOT_NULL(read_content);
@@ -188,6 +228,107 @@ void test_read_small(void)
 	TEST_ASSERT_EQUAL(remove(test_path), 0);
 }
 
+void test_open_cstr_read(void)
+{
+	const char *test_path = "test_sio_linux.txt";
+	remove(test_path);
+
+	const char *content = "no allocations\nbut the content";
+	TEST_ASSERT_TRUE(write_test_file(test_path, content));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+
+	const size_t allocs_before = nallocs;
+
+	struct sio_file file;
+	TEST_ASSERT_TRUE(sio_open_cstr(ctx, test_path, "r", &file));
+	TEST_ASSERT_GREATER_OR_EQUAL(0, file.fd);
+
+	struct sio_string read_content = {.length = 0, .chars = nullptr};
+	TEST_ASSERT_TRUE(sio_read_file_into(ctx, &file, &read_content));
+	TEST_ASSERT_EQUAL(read_content.length, strlen(content));
+	TEST_ASSERT_EQUAL_STRING(read_content.chars, content);
+
+	sio_file_close(ctx, &file);
+	TEST_ASSERT_EQUAL(file.fd, -1);
+
+	/* the content buffer is the only allocation */
+	TEST_ASSERT_EQUAL(nallocs - allocs_before, 1);
+	free(read_content.chars);
+
+	TEST_ASSERT_FALSE(
+	    sio_open_cstr(ctx, "/path/that/does/not/exist", "r", &file));
+	TEST_ASSERT_EQUAL(file.fd, -1);
+
+	sio_context_destroy(ctx);
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+void test_read_files_into(void)
+{
+	const char *paths[] = {"test_sio_linux_0.txt", "test_sio_linux_1.txt",
+			       "test_sio_linux_2.txt"};
+	const char *contents[] = {"first file", "", "third\nfile"};
+	const size_t count = 3;
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+
+	struct sio_file files[3];
+	struct sio_string out[3] = {0};
+	for (size_t i = 0; i < count; i++) {
+		remove(paths[i]);
+		TEST_ASSERT_TRUE(write_test_file(paths[i], contents[i]));
+		TEST_ASSERT_TRUE(sio_open_cstr(ctx, paths[i], "r", &files[i]));
+	}
+
+	TEST_ASSERT_TRUE(sio_read_files_into(ctx, files, count, out));
+	for (size_t i = 0; i < count; i++) {
+		TEST_ASSERT_EQUAL(out[i].length, strlen(contents[i]));
+		if (out[i].length != 0)
+			TEST_ASSERT_EQUAL_STRING(out[i].chars, contents[i]);
+		free(out[i].chars);
+		sio_file_close(ctx, &files[i]);
+		TEST_ASSERT_EQUAL(remove(paths[i]), 0);
+	}
+
+	sio_context_destroy(ctx);
+}
+
+/* more files than ring entries, completions have to refill the ring */
+void test_read_files_into_many(void)
+{
+	const size_t count = 300;
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+
+	struct sio_file files[300];
+	struct sio_string out[300] = {0};
+	char path[64];
+	char content[64];
+	for (size_t i = 0; i < count; i++) {
+		snprintf(path, sizeof(path), "test_sio_linux_%zu.txt", i);
+		snprintf(content, sizeof(content), "content of file %zu", i);
+		remove(path);
+		TEST_ASSERT_TRUE(write_test_file(path, content));
+		TEST_ASSERT_TRUE(sio_open_cstr(ctx, path, "r", &files[i]));
+	}
+
+	TEST_ASSERT_TRUE(sio_read_files_into(ctx, files, count, out));
+	for (size_t i = 0; i < count; i++) {
+		snprintf(path, sizeof(path), "test_sio_linux_%zu.txt", i);
+		snprintf(content, sizeof(content), "content of file %zu", i);
+		TEST_ASSERT_EQUAL(out[i].length, strlen(content));
+		TEST_ASSERT_EQUAL_STRING(out[i].chars, content);
+		free(out[i].chars);
+		sio_file_close(ctx, &files[i]);
+		TEST_ASSERT_EQUAL(remove(path), 0);
+	}
+
+	sio_context_destroy(ctx);
+}
+
 void test_close_nullptr(void)
 {
 	struct sio_context *ctx = sio_context_init();
@@ -212,7 +353,7 @@ void test_open_close(void)
 
 	struct sio_file *file = sio_open(ctx, path, "r");
 	TEST_ASSERT_NOT_NULL(file);
-	TEST_ASSERT_NOT_NULL(file->file);
+	TEST_ASSERT_GREATER_OR_EQUAL(0, file->fd);
 
 	sio_close(ctx, file);
 	sio_path_free(path);
@@ -311,6 +452,510 @@ void test_read_null_bytes(void)
 	sio_context_destroy(ctx);
 }
 
+/* SIO_DIR */
+void test_dir_open_non_existent(void)
+{
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+
+	struct sio_path *path = sio_path_from_c_str("/path/that/does/not/exist");
+	struct sio_dir *dir = sio_dir_open(ctx, path);
+	TEST_ASSERT_NULL(dir);
+
+	sio_path_free(path);
+	sio_context_destroy(ctx);
+}
+
+void test_open_at_read(void)
+{
+	const char *test_dir = "test_sio_linux_dir";
+	const char *test_path = "test_sio_linux_dir/file.txt";
+	remove(test_path);
+	rmdir(test_dir);
+	TEST_ASSERT_EQUAL(mkdir(test_dir, 0755), 0);
+
+	const char *content = "relative\ncontent";
+	TEST_ASSERT_TRUE(write_test_file(test_path, content));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+
+	struct sio_path *dir_path = sio_path_from_c_str(test_dir);
+	struct sio_dir *dir = sio_dir_open(ctx, dir_path);
+	TEST_ASSERT_NOT_NULL(dir);
+
+	struct sio_path *path = sio_path_from_c_str("file.txt");
+	struct sio_file *file =
+	    sio_open_at(ctx, dir, path, "r", SIO_RESOLVE_BENEATH);
+	TEST_ASSERT_NOT_NULL(file);
+
+	struct sio_string *read_content = sio_read_file(ctx, file);
+	TEST_ASSERT_NOT_NULL(read_content);
+	TEST_ASSERT_EQUAL(read_content->length, strlen(content));
+	TEST_ASSERT_EQUAL_STRING(read_content->chars, content);
+
+	sio_close(ctx, file);
+	sio_string_free(read_content);
+	sio_path_free(path);
+	sio_dir_close(ctx, dir);
+	sio_path_free(dir_path);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+	TEST_ASSERT_EQUAL(rmdir(test_dir), 0);
+}
+
+void test_open_at_cached(void)
+{
+	const char *test_dir = "test_sio_linux_dir";
+	const char *test_path = "test_sio_linux_dir/file.txt";
+	remove(test_path);
+	rmdir(test_dir);
+	TEST_ASSERT_EQUAL(mkdir(test_dir, 0755), 0);
+	TEST_ASSERT_TRUE(write_test_file(test_path, "cached"));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+
+	struct sio_path *dir_path = sio_path_from_c_str(test_dir);
+	struct sio_dir *dir = sio_dir_open(ctx, dir_path);
+	TEST_ASSERT_NOT_NULL(dir);
+
+	/* a dcache miss is allowed to fail with EAGAIN, callers then retry */
+	struct sio_path *path = sio_path_from_c_str("file.txt");
+	errno = 0;
+	struct sio_file *file =
+	    sio_open_at(ctx, dir, path, "r", SIO_RESOLVE_CACHED);
+	if (!file) {
+		TEST_ASSERT_EQUAL(errno, EAGAIN);
+		file = sio_open_at(ctx, dir, path, "r", SIO_RESOLVE_NONE);
+	}
+	TEST_ASSERT_NOT_NULL(file);
+
+	struct sio_string *read_content = sio_read_file(ctx, file);
+	TEST_ASSERT_NOT_NULL(read_content);
+	TEST_ASSERT_EQUAL_STRING(read_content->chars, "cached");
+
+	sio_close(ctx, file);
+	sio_string_free(read_content);
+	sio_path_free(path);
+	sio_dir_close(ctx, dir);
+	sio_path_free(dir_path);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+	TEST_ASSERT_EQUAL(rmdir(test_dir), 0);
+}
+
+void test_open_at_beneath_rejects_escape(void)
+{
+	const char *test_dir = "test_sio_linux_dir";
+	rmdir(test_dir);
+	TEST_ASSERT_EQUAL(mkdir(test_dir, 0755), 0);
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+
+	struct sio_path *dir_path = sio_path_from_c_str(test_dir);
+	struct sio_dir *dir = sio_dir_open(ctx, dir_path);
+	TEST_ASSERT_NOT_NULL(dir);
+
+	struct sio_path *path = sio_path_from_c_str("../test_sio_linux.c");
+	struct sio_file *file =
+	    sio_open_at(ctx, dir, path, "r", SIO_RESOLVE_BENEATH);
+	TEST_ASSERT_NULL(file);
+	TEST_ASSERT_EQUAL(errno, EXDEV);
+
+	sio_path_free(path);
+	sio_dir_close(ctx, dir);
+	sio_path_free(dir_path);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(rmdir(test_dir), 0);
+}
+
+/* SIO_PARALLEL */
+struct chunk_stats {
+	atomic_size_t chunks;
+	atomic_size_t bytes;
+	atomic_size_t lines;
+	atomic_bool misaligned;
+};
+
+static bool count_lines(void *user, struct sio_span chunk, size_t index)
+{
+	struct chunk_stats *stats = user;
+	(void)index;
+
+	size_t lines = 0;
+	for (size_t i = 0; i < chunk.length; i++)
+		lines += chunk.chars[i] == '\n';
+	if (chunk.chars[chunk.length - 1] != '\n')
+		atomic_store(&stats->misaligned, true);
+
+	atomic_fetch_add(&stats->chunks, 1);
+	atomic_fetch_add(&stats->bytes, chunk.length);
+	atomic_fetch_add(&stats->lines, lines);
+	return true;
+}
+
+static bool stop_at_first(void *user, struct sio_span chunk, size_t index)
+{
+	(void)user;
+	(void)chunk;
+	return index != 0;
+}
+
+void test_parallel_for_chunks(void)
+{
+	const char *test_path = "test_sio_linux.txt";
+	remove(test_path);
+
+	FILE *f = fopen(test_path, "w");
+	TEST_ASSERT_TRUE(f);
+	const size_t nlines = 10000;
+	size_t len = 0;
+	for (size_t i = 0; i < nlines; i++)
+		len += (size_t)fprintf(f, "line %zu\n", i);
+	TEST_ASSERT_EQUAL(fclose(f), 0);
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_path *path = sio_path_from_c_str(test_path);
+	struct sio_file *file = sio_open(ctx, path, "r");
+	TEST_ASSERT_NOT_NULL(file);
+
+	struct chunk_stats stats = {0};
+	TEST_ASSERT_EQUAL(sio_parallel_for_chunks(ctx, file, 100, '\n',
+						  count_lines, &stats, 4),
+			  0);
+	TEST_ASSERT_GREATER_THAN(1, atomic_load(&stats.chunks));
+	TEST_ASSERT_EQUAL(atomic_load(&stats.bytes), len);
+	TEST_ASSERT_EQUAL(atomic_load(&stats.lines), nlines);
+	TEST_ASSERT_FALSE(atomic_load(&stats.misaligned));
+
+	TEST_ASSERT_EQUAL(sio_parallel_for_chunks(ctx, file, 100, '\n',
+						  stop_at_first, nullptr, 1),
+			  1);
+
+	sio_close(ctx, file);
+	TEST_ASSERT_EQUAL(sio_parallel_for_chunks(ctx, nullptr, 100, '\n',
+						  count_lines, &stats, 1),
+			  -EBADF);
+
+	sio_path_free(path);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+struct tail_chunk {
+	size_t count;
+	char text[8];
+};
+
+/* copies chunks missing a delim, the mapping is gone once the call returns */
+static bool last_chunk(void *user, struct sio_span chunk, size_t index)
+{
+	struct tail_chunk *tail = user;
+	(void)index;
+	if (chunk.chars[chunk.length - 1] != '\n' &&
+	    chunk.length < sizeof(tail->text)) {
+		memcpy(tail->text, chunk.chars, chunk.length);
+		tail->count++;
+	}
+	return true;
+}
+
+void test_parallel_for_chunks_unterminated(void)
+{
+	const char *test_path = "test_sio_linux.txt";
+	remove(test_path);
+	TEST_ASSERT_TRUE(write_test_file(test_path, "ab\ncd\nef"));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_file file;
+	TEST_ASSERT_TRUE(sio_open_cstr(ctx, test_path, "r", &file));
+
+	/* only the final chunk may miss its delim */
+	struct tail_chunk tail = {0};
+	TEST_ASSERT_EQUAL(sio_parallel_for_chunks(ctx, &file, 1, '\n',
+						  last_chunk, &tail, 1),
+			  0);
+	TEST_ASSERT_EQUAL(tail.count, 1);
+	TEST_ASSERT_EQUAL_STRING("ef", tail.text);
+
+	sio_file_close(ctx, &file);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+void test_parallel_for_chunks_tiny_chunk_size(void)
+{
+	const char *test_path = "test_sio_linux.bin";
+	remove(test_path);
+	TEST_ASSERT_TRUE(write_test_file(test_path, ""));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_file file;
+	TEST_ASSERT_TRUE(sio_open_cstr(ctx, test_path, "r", &file));
+
+	/* a delim that never occurs leaves one chunk, whatever chunk_size */
+	const size_t size = 64 << 20;
+	TEST_ASSERT_EQUAL(truncate(test_path, size), 0);
+	struct chunk_stats stats = {0};
+	TEST_ASSERT_EQUAL(sio_parallel_for_chunks(ctx, &file, 1, '\n',
+						  count_lines, &stats, 1),
+			  0);
+	TEST_ASSERT_EQUAL(atomic_load(&stats.chunks), 1);
+	TEST_ASSERT_EQUAL(atomic_load(&stats.bytes), size);
+
+	/* more possible chunks than 32-bit indices is refused up front */
+	TEST_ASSERT_EQUAL(truncate(test_path, (off_t)5 << 30), 0);
+	TEST_ASSERT_EQUAL(sio_parallel_for_chunks(ctx, &file, 1, '\n',
+						  count_lines, &stats, 1),
+			  -EOVERFLOW);
+
+	sio_file_close(ctx, &file);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+/* SIO_INDEX */
+void test_index_records(void)
+{
+	const char *test_path = "test_sio_linux.txt";
+	const char *sidecar = "test_sio_linux.txt.sioidx";
+	remove(test_path);
+	remove(sidecar);
+	TEST_ASSERT_TRUE(write_test_file(test_path, "first\n\nthird\nlast"));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_path *path = sio_path_from_c_str(test_path);
+
+	/* first open builds and persists the sidecar, second one reuses it */
+	for (int pass = 0; pass < 2; pass++) {
+		struct sio_index *index = sio_index_open(ctx, path, '\n');
+		TEST_ASSERT_NOT_NULL(index);
+		TEST_ASSERT_EQUAL(access(sidecar, F_OK), 0);
+		TEST_ASSERT_EQUAL(sio_index_count(index), 4);
+
+		struct sio_span span = sio_record_get(index, 0);
+		TEST_ASSERT_EQUAL(span.length, 5);
+		TEST_ASSERT_EQUAL_STRING_LEN(span.chars, "first", 5);
+		span = sio_record_get(index, 1);
+		TEST_ASSERT_NOT_NULL(span.chars);
+		TEST_ASSERT_EQUAL(span.length, 0);
+		span = sio_record_get(index, 3);
+		TEST_ASSERT_EQUAL(span.length, 4);
+		TEST_ASSERT_EQUAL_STRING_LEN(span.chars, "last", 4);
+		span = sio_record_get(index, 4);
+		TEST_ASSERT_NULL(span.chars);
+
+		sio_index_close(index);
+	}
+
+	sio_path_free(path);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(remove(sidecar), 0);
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+void test_index_stale_sidecar(void)
+{
+	const char *test_path = "test_sio_linux.txt";
+	const char *sidecar = "test_sio_linux.txt.sioidx";
+	remove(test_path);
+	remove(sidecar);
+	TEST_ASSERT_TRUE(write_test_file(test_path, "a\nb\n"));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_path *path = sio_path_from_c_str(test_path);
+
+	struct sio_index *index = sio_index_open(ctx, path, '\n');
+	TEST_ASSERT_NOT_NULL(index);
+	TEST_ASSERT_EQUAL(sio_index_count(index), 2);
+	sio_index_close(index);
+
+	TEST_ASSERT_TRUE(write_test_file(test_path, "a\nb\nlonger c\n"));
+	index = sio_index_open(ctx, path, '\n');
+	TEST_ASSERT_NOT_NULL(index);
+	TEST_ASSERT_EQUAL(sio_index_count(index), 3);
+	struct sio_span span = sio_record_get(index, 2);
+	TEST_ASSERT_EQUAL(span.length, 8);
+	TEST_ASSERT_EQUAL_STRING_LEN(span.chars, "longer c", 8);
+	sio_index_close(index);
+
+	sio_path_free(path);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(remove(sidecar), 0);
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+/* overwrites one 64-bit field of the sidecar, leaving the data file alone */
+static bool poke_sidecar(const char *sidecar, off_t offset, uint64_t value)
+{
+	const int fd = open(sidecar, O_WRONLY);
+	if (fd == -1)
+		return false;
+	const bool ok = pwrite(fd, &value, sizeof(value), offset) ==
+			(ssize_t)sizeof(value);
+	return close(fd) == 0 && ok;
+}
+
+void test_index_corrupt_sidecar(void)
+{
+	const char *test_path = "test_sio_linux.txt";
+	const char *sidecar = "test_sio_linux.txt.sioidx";
+	remove(test_path);
+	remove(sidecar);
+	TEST_ASSERT_TRUE(write_test_file(test_path, "a\nb\n"));
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_path *path = sio_path_from_c_str(test_path);
+
+	/* an offset past the end of the file, then a count that wraps */
+	const off_t field[] = {56, 32};
+	const uint64_t value[] = {1ull << 40, 2 + (1ull << 61)};
+	for (int i = 0; i < 2; i++) {
+		struct sio_index *index = sio_index_open(ctx, path, '\n');
+		TEST_ASSERT_NOT_NULL(index);
+		sio_index_close(index);
+		TEST_ASSERT_TRUE(poke_sidecar(sidecar, field[i], value[i]));
+
+		index = sio_index_open(ctx, path, '\n');
+		TEST_ASSERT_NOT_NULL(index);
+		TEST_ASSERT_EQUAL(sio_index_count(index), 2);
+		struct sio_span span = sio_record_get(index, 1);
+		TEST_ASSERT_EQUAL(span.length, 1);
+		TEST_ASSERT_EQUAL_STRING_LEN(span.chars, "b", 1);
+		sio_index_close(index);
+	}
+
+	sio_path_free(path);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(remove(sidecar), 0);
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+/* SIO_LOG */
+static void count_done(void *user, int res)
+{
+	if (res == 0)
+		(*(int *)user)++;
+}
+
+void test_log_append_flush(void)
+{
+	const char *test_path = "test_sio_linux.log";
+	remove(test_path);
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_path *path = sio_path_from_c_str(test_path);
+	struct sio_log *log = sio_log_open(ctx, path, 8);
+	TEST_ASSERT_NOT_NULL(log);
+
+	int done = 0;
+	TEST_ASSERT_TRUE(sio_log_append(log, "one\n", 4, count_done, &done));
+	TEST_ASSERT_TRUE(sio_log_append(log, "two\n", 4, count_done, &done));
+	TEST_ASSERT_TRUE(sio_log_append(log, "three\n", 6, count_done, &done));
+	TEST_ASSERT_EQUAL(done, 0);
+	TEST_ASSERT_EQUAL(sio_log_flush(log), 3);
+	TEST_ASSERT_EQUAL(done, 3);
+	TEST_ASSERT_EQUAL(sio_log_flush(log), 0);
+
+	TEST_ASSERT_TRUE(sio_log_append(log, "four\n", 5, count_done, &done));
+	sio_log_close(log);
+	TEST_ASSERT_EQUAL(done, 4);
+
+	struct sio_file *file = sio_open(ctx, path, "r");
+	TEST_ASSERT_NOT_NULL(file);
+	struct sio_string *content = sio_read_file(ctx, file);
+	TEST_ASSERT_NOT_NULL(content);
+	TEST_ASSERT_EQUAL_STRING(content->chars, "one\ntwo\nthree\nfour\n");
+
+	sio_close(ctx, file);
+	sio_string_free(content);
+	sio_path_free(path);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+void test_log_append_full(void)
+{
+	const char *test_path = "test_sio_linux.log";
+	remove(test_path);
+
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_path *path = sio_path_from_c_str(test_path);
+	struct sio_log *log = sio_log_open(ctx, path, 2);
+	TEST_ASSERT_NOT_NULL(log);
+
+	int done = 0;
+	TEST_ASSERT_TRUE(sio_log_append(log, "a", 1, count_done, &done));
+	TEST_ASSERT_TRUE(sio_log_append(log, "b", 1, count_done, &done));
+	TEST_ASSERT_FALSE(sio_log_append(log, "c", 1, count_done, &done));
+	TEST_ASSERT_EQUAL(sio_log_flush(log), 2);
+	TEST_ASSERT_EQUAL(done, 2);
+	TEST_ASSERT_TRUE(sio_log_append(log, "c", 1, count_done, &done));
+	TEST_ASSERT_EQUAL(sio_log_flush(log), 1);
+
+	/* an empty record is durable without writing any bytes */
+	TEST_ASSERT_TRUE(sio_log_append(log, "", 0, count_done, &done));
+	TEST_ASSERT_EQUAL(sio_log_flush(log), 1);
+
+	sio_log_close(log);
+	TEST_ASSERT_EQUAL(done, 4);
+	sio_path_free(path);
+	sio_context_destroy(ctx);
+
+	TEST_ASSERT_EQUAL(remove(test_path), 0);
+}
+
+static void count_enospc(void *user, int res)
+{
+	if (res == -ENOSPC)
+		(*(int *)user)++;
+}
+
+void test_log_failed_batch(void)
+{
+	struct sio_context *ctx = sio_context_init();
+	TEST_ASSERT_NOT_NULL(ctx);
+	struct sio_path *path = sio_path_from_c_str("/dev/full");
+	struct sio_log *log = sio_log_open(ctx, path, 2048);
+	TEST_ASSERT_NOT_NULL(log);
+
+	/* more records than one writev batch, the later ones share the error */
+	const int nrecords = 1500;
+	int failed = 0;
+	for (int i = 0; i < nrecords; i++)
+		TEST_ASSERT_TRUE(
+		    sio_log_append(log, "x", 1, count_enospc, &failed));
+	TEST_ASSERT_EQUAL(sio_log_flush(log), -ENOSPC);
+	TEST_ASSERT_EQUAL(failed, nrecords);
+
+	TEST_ASSERT_TRUE(sio_log_append(log, "y", 1, count_enospc, &failed));
+	sio_log_close(log);
+	TEST_ASSERT_EQUAL(failed, nrecords + 1);
+
+	sio_path_free(path);
+	sio_context_destroy(ctx);
+}
+
 int main(void)
 {
 	UNITY_BEGIN();
@@ -324,16 +969,41 @@ int main(void)
 	/* SIO_PATH */
 	RUN_TEST(test_sio_path_new);
 	RUN_TEST(test_sio_path_from_c_str);
+	RUN_TEST(test_sio_path_view);
 
 	/* SIO_FILE */
 	RUN_TEST(test_open_non_existent);
 	RUN_TEST(test_open_close);
 	RUN_TEST(test_read_small);
+	RUN_TEST(test_open_cstr_read);
+	RUN_TEST(test_read_files_into);
+	RUN_TEST(test_read_files_into_many);
 	RUN_TEST(test_read_4096_bytes);
 	RUN_TEST(test_open_empty);
 	RUN_TEST(test_close_nullptr);
 	RUN_TEST(test_read_null_bytes);
 
+	/* SIO_DIR */
+	RUN_TEST(test_dir_open_non_existent);
+	RUN_TEST(test_open_at_read);
+	RUN_TEST(test_open_at_cached);
+	RUN_TEST(test_open_at_beneath_rejects_escape);
+
+	/* SIO_PARALLEL */
+	RUN_TEST(test_parallel_for_chunks);
+	RUN_TEST(test_parallel_for_chunks_unterminated);
+	RUN_TEST(test_parallel_for_chunks_tiny_chunk_size);
+
+	/* SIO_INDEX */
+	RUN_TEST(test_index_records);
+	RUN_TEST(test_index_stale_sidecar);
+	RUN_TEST(test_index_corrupt_sidecar);
+
+	/* SIO_LOG */
+	RUN_TEST(test_log_append_flush);
+	RUN_TEST(test_log_append_full);
+	RUN_TEST(test_log_failed_batch);
+
 	/* SIO_CONTEXT */
 	RUN_TEST(test_open_non_existent);
 